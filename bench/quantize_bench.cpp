@@ -0,0 +1,170 @@
+/* Benchmark and round-trip checks for wingdi/quantize.cpp (portable, no Windows headers needed).
+
+   build & run from the repository root:
+      g++ -std=c++17 -O2 -o quantize_bench bench/quantize_bench.cpp wingdi/quantize.cpp && ./quantize_bench
+
+   with sanitizers:
+      g++ -std=c++17 -O1 -g -fsanitize=address,undefined -o quantize_bench bench/quantize_bench.cpp wingdi/quantize.cpp && ./quantize_bench
+*/
+
+#include "../wingdi/quantize.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace GDIUtil;
+
+namespace
+{
+   int failures = 0;
+
+   // not assert(): must also check in -DNDEBUG builds
+   void Check(bool ok, char const * what)
+   {
+      if (!ok)
+      {
+         printf("FAILED: %s\n", what);
+         ++failures;
+      }
+   }
+
+   template <typename TOp>
+   double TimeMs(TOp op, int repeat = 5)
+   {
+      double best = 1e30;
+      for (int i = 0; i < repeat; ++i)
+      {
+         auto start = std::chrono::steady_clock::now();
+         op();
+         best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      }
+      return best;
+   }
+
+   const int W = 2048;
+   const int H = 2048;
+   const size_t N = size_t(W) * H;
+
+   /// flat UI art: 40 opaque colors in blocks, with keyed transparent pixels (alpha = 0, RGB != 0)
+   std::vector<uint32_t> MakeFlat(bool withAlpha)
+   {
+      std::mt19937 rng(1);
+      uint32_t colors[40];
+      for (auto & c : colors)
+         c = (withAlpha ? 0xFF000000 : 0) | (rng() & 0xFFFFFF);
+
+      std::vector<uint32_t> img(N);
+      for (int y = 0; y < H; ++y)
+         for (int x = 0; x < W; ++x)
+            img[size_t(y) * W + x] = (withAlpha && (x / 37 + y / 23) % 7 == 0) ? 0x00123456 : colors[(x / 64 + y / 16) % 40];
+      return img;
+   }
+
+   /// gradient with many colors and a few transparent pixels
+   std::vector<uint32_t> MakePhoto()
+   {
+      std::vector<uint32_t> img(N);
+      for (int y = 0; y < H; ++y)
+         for (int x = 0; x < W; ++x)
+            img[size_t(y) * W + x] = ((x ^ y) & 1023) == 0 ? 0 : 0xFF000000 | ((x * 255 / W) << 16) | ((y * 255 / H) << 8) | ((x + y) & 255);
+      return img;
+   }
+
+   void BenchFlat(bool withAlpha)
+   {
+      std::vector<uint32_t> src = MakeFlat(withAlpha);
+      std::vector<uint32_t> out(N);
+      IndexedImage img;
+      bool lossless = false;
+
+      double tq = TimeMs([&] { lossless = QuantizeImage(src.data(), W, -H, img); });
+      double te = TimeMs([&] { ExpandIndexed(img, out.data()); });
+
+      size_t wrong = 0;
+      for (size_t i = 0; i < N; ++i)
+      {
+         uint32_t expected = (withAlpha && !(src[i] >> 24)) ? 0 : src[i];
+         wrong += out[i] != expected;
+      }
+
+      printf("flat %-10s exact path: palette %3zu, quantize %7.2f ms, expand %6.2f ms\n",
+         withAlpha ? "(alpha)" : "(no alpha)", img.palette.size(), tq, te);
+      Check(wrong == 0, "flat: round trip");
+      Check(img.palette.size() == (withAlpha ? 41u : 40u), "flat: palette size");
+      Check((img.transparentIndex >= 0) == withAlpha, "flat: transparent index");
+      // with alpha, the keyed pixels had RGB != 0 that was dropped
+      Check(lossless == !withAlpha, "flat: lossless flag");
+   }
+
+   void BenchOctree(bool dither)
+   {
+      std::vector<uint32_t> src = MakePhoto();
+      std::vector<uint32_t> out(N);
+      IndexedImage img;
+      bool lossless = true;
+
+      double tq = TimeMs([&] { lossless = QuantizeImage(src.data(), W, H, img, dither); }, 3);
+      ExpandIndexed(img, out.data());
+
+      size_t wrongAlpha = 0;
+      double err = 0;
+      for (size_t i = 0; i < N; ++i)
+      {
+         if (!(src[i] >> 24))
+         {
+            wrongAlpha += out[i] != 0;
+            continue;
+         }
+         wrongAlpha += (out[i] >> 24) != 0xFF;
+         for (int shift = 0; shift < 24; shift += 8)
+         {
+            int e = int((src[i] >> shift) & 0xFF) - int((out[i] >> shift) & 0xFF);
+            err += e * e;
+         }
+      }
+      double rmse = sqrt(err / N / 3);
+
+      printf("octree %-8s        palette %3zu, quantize %7.2f ms, rmse %.2f\n",
+         dither ? "(dither)" : "", img.palette.size(), tq, rmse);
+      Check(!lossless, "octree: lossless flag");
+      Check(img.palette.size() <= 256, "octree: palette size");
+      Check(img.transparentIndex == 0 && img.palette[0] == 0, "octree: transparent entry");
+      Check(wrongAlpha == 0, "octree: keyed transparency");
+      Check(rmse < 24, "octree: error");
+   }
+
+   void CheckEdgeCases()
+   {
+      std::vector<uint32_t> palette;
+      uint8_t index = 0xFF;
+      int transparentIndex = 0;
+
+      Check(QuantizeExact(nullptr, 0, nullptr, palette, &transparentIndex) && palette.size() == 1, "exact: empty image");
+      QuantizeOctree(nullptr, 0, 0, nullptr, palette);
+      Check(palette.size() == 1, "octree: empty image");
+
+      IndexedImage img;
+      Check(QuantizeImage(nullptr, 0, 0, img) && img.palette.size() == 1, "image: empty image");
+
+      // a single pixel without alpha channel keeps its color
+      uint32_t pixel = 0x00ABCDEF;
+      Check(QuantizeExact(&pixel, 1, &index, palette, &transparentIndex) && palette[index] == pixel && transparentIndex == -1, "exact: no alpha channel");
+      QuantizeOctree(&pixel, 1, 1, &index, palette, true, &transparentIndex);
+      Check(palette[index] == pixel && transparentIndex == -1, "octree: no alpha channel");
+   }
+}
+
+int main()
+{
+   BenchFlat(true);
+   BenchFlat(false);
+   BenchOctree(false);
+   BenchOctree(true);
+   CheckEdgeCases();
+
+   printf(failures ? "%d check(s) FAILED\n" : "all checks passed\n", failures);
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include "pch.h"
 
 #include "wingdi/bmputil.h"
+#include "wingdi/quantize.h"
 #include "wingdi/savebmp.h"
 #include "wingdi/wicutil.h"
@@ -103,4 +103,51 @@ namespace GDIUtil
       return result;
    }
 
+
+   /** Converts \c bmp to an 8 bit/pixel image with a palette (see \ref QuantizeImage).
+       Flat-colored images with up to 256 colors are converted exactly, using 1/4 of the memory.
+
+       \c bmp must be an RGBA (32 bit/pixel) DIB section, e.g. from \ref CreateRGBADIBSection.
+       If the bitmap has an alpha channel (any pixel with alpha != 0), transparent pixels (alpha = 0)
+       share a single palette entry, see \ref IndexedImage::transparentIndex. Bitmaps GDI has drawn into
+       (all alpha = 0) keep their colors.
+       Use \ref BitmapFromIndexed to convert back.
+
+       \param lossless [out, optional] receives true if \ref BitmapFromIndexed restores \c bmp exactly,
+          i.e. the original can be discarded. See \ref QuantizeImage.
+   */
+   bool BitmapQuantize(HBITMAP bmp, IndexedImage & result, bool dither, bool * lossless)
+   {
+      DIBSECTION dibinfo = {};
+      if (!GetObject(bmp, sizeof(dibinfo), &dibinfo))
+         return false;
+
+      // must be a 32 bit uncompressed bitmap
+      if (dibinfo.dsBmih.biBitCount != 32 ||
+         dibinfo.dsBmih.biCompression != BI_RGB)
+      {
+         SetLastError(ERROR_INVALID_DATA);
+         return false;
+      }
+
+      GdiFlush(); // make sure GDI has finished drawing to the bits
+      bool const exact = QuantizeImage((uint32_t const *)dibinfo.dsBm.bmBits, dibinfo.dsBmih.biWidth, dibinfo.dsBmih.biHeight, result, dither);
+      if (lossless)
+         *lossless = exact;
+      return true;
+   }
+
+
+   /** Creates an RGBA DIB section from an \ref IndexedImage, with the same size and orientation */
+   HBITMAP BitmapFromIndexed(IndexedImage const & image)
+   {
+      uint32_t * bits = nullptr;
+      HBITMAP result = CreateRGBADIBSection({ image.width, image.height }, &bits);
+      if (!result)
+         return nullptr;
+
+      ExpandIndexed(image, bits);
+      return result;
+   }
+
 } // namespace GDIUtil
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include "quantize.h"
 
 /** a very spotty collection of helpers for making some selected GDI operations easier
 */
@@ -12,4 +13,7 @@ namespace GDIUtil
    bool BitmapMakeTransparentInPlace(HBITMAP bmp, COLORREF transparentColor);
    HBITMAP BitmapMakeTransparent(HBITMAP bmp, COLORREF transparentColor);
 
+   bool BitmapQuantize(HBITMAP bmp, IndexedImage & result, bool dither = false, bool * lossless = nullptr);
+   HBITMAP BitmapFromIndexed(IndexedImage const & image);
+
 }
@@ -0,0 +1,495 @@
+#include "quantize.h"
+#include <string.h>
+#include <algorithm>
+
+/* Color quantization for flat-colored UI art.
+
+   Most images we cache use only a handful of colors, so QuantizeImage first tries
+   an exact palette (QuantizeExact), which is lossless up to keyed transparency (see below).
+   Only images with more than 256 distinct colors go through the octree quantizer (Gervautz / Purgathofer),
+   optionally with Floyd-Steinberg dithering.
+
+   Keyed transparency: if the image has an alpha channel (i.e. at least one pixel with alpha != 0),
+   all pixels with alpha = 0 are treated as "the" transparent color, and get a palette entry
+   of their own that expands back to 0 (as produced by \ref BitmapMakeTransparentInPlace).
+   Other alpha values are kept by the exact path, and averaged per palette entry by the octree path.
+   Images where all pixels have alpha = 0 (e.g. after GDI drew into a DIB section) are
+   quantized on their full 32 bit value.
+
+   This file deliberately does not include pch.h (and Windows.h), see quantize.h.
+*/
+
+namespace GDIUtil
+{
+
+   namespace
+   {
+      /// true if at least one pixel has alpha != 0; otherwise alpha is not used, and must not be keyed
+      bool HasAlphaChannel(uint32_t const * src, size_t count)
+      {
+         for (size_t i = 0; i < count; ++i)
+            if (src[i] >> 24)
+               return true;
+         return false;
+      }
+
+      inline int ChR(uint32_t c) { return (c >> 16) & 0xFF; }
+      inline int ChG(uint32_t c) { return (c >> 8) & 0xFF; }
+      inline int ChB(uint32_t c) { return c & 0xFF; }
+      inline int Clamp255(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+      /// open-addressing color -> index map, sized for up to 256 entries
+      class CColorIndexMap
+      {
+      public:
+         CColorIndexMap() { memset(m_index, 0xFF, sizeof(m_index)); }
+
+         /// returns the index of \c c, or -1 if it is not in the map
+         int Find(uint32_t c, unsigned & slot) const
+         {
+            slot = Hash(c);
+            while (m_index[slot] >= 0)
+            {
+               if (m_key[slot] == c)
+                  return m_index[slot];
+               slot = (slot + 1) & (Slots - 1);
+            }
+            return -1;
+         }
+
+         void Insert(unsigned slot, uint32_t c, int index)
+         {
+            m_key[slot] = c;
+            m_index[slot] = int16_t(index);
+         }
+
+      private:
+         enum { Slots = 1024 };  // load factor <= 1/4
+         static unsigned Hash(uint32_t c) { return (c * 2654435761u) >> 22; }
+
+         uint32_t m_key[Slots];
+         int16_t m_index[Slots];
+      };
+
+
+      /** octree with at most \c maxColors leaves; a node's level is the number of bits per channel that identify it */
+      class COctree
+      {
+      public:
+         explicit COctree(int maxColors) : m_maxColors(maxColors)
+         {
+            m_root = NewNode(0);
+         }
+
+         void Add(uint32_t c, uint32_t count)
+         {
+            int32_t n = m_root;
+            for (int level = 0; !m_nodes[n].leaf; ++level)
+            {
+               int const ci = ChildIndex(c, level);
+               int32_t child = m_nodes[n].children[ci];
+               if (child < 0)
+               {
+                  child = NewNode(level + 1);  // may reallocate m_nodes
+                  m_nodes[n].children[ci] = child;
+               }
+               n = child;
+            }
+
+            Node & leaf = m_nodes[n];
+            leaf.sum[0] += uint64_t(ChR(c)) * count;
+            leaf.sum[1] += uint64_t(ChG(c)) * count;
+            leaf.sum[2] += uint64_t(ChB(c)) * count;
+            leaf.sum[3] += uint64_t(c >> 24) * count;
+            leaf.count += count;
+
+            while (m_leafCount > m_maxColors)
+               Reduce();
+         }
+
+         /// assigns palette indices to the leaves, starting at \c palette.size()
+         void BuildPalette(std::vector<uint32_t> & palette)
+         {
+            AssignPalette(m_root, palette);
+         }
+
+         /// palette index for a color that has been added to the tree
+         int Lookup(uint32_t c) const
+         {
+            int32_t n = m_root;
+            for (int level = 0; !m_nodes[n].leaf; ++level)
+               n = m_nodes[n].children[ChildIndex(c, level)];
+            return m_nodes[n].paletteIndex;
+         }
+
+      private:
+         enum { MaxDepth = 8 };
+
+         struct Node
+         {
+            uint64_t sum[4] = {};
+            uint32_t count = 0;
+            int32_t children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+            int paletteIndex = -1;
+            bool leaf = false;
+         };
+
+         static int ChildIndex(uint32_t c, int level)
+         {
+            int shift = 7 - level;
+            return (((ChR(c) >> shift) & 1) << 2) | (((ChG(c) >> shift) & 1) << 1) | ((ChB(c) >> shift) & 1);
+         }
+
+         int32_t NewNode(int level)
+         {
+            int32_t n;
+            if (!m_free.empty())
+            {
+               n = m_free.back();
+               m_free.pop_back();
+               m_nodes[n] = Node();
+            }
+            else
+            {
+               n = int32_t(m_nodes.size());
+               m_nodes.emplace_back();
+            }
+
+            if (level == MaxDepth)
+            {
+               m_nodes[n].leaf = true;
+               ++m_leafCount;
+            }
+            else
+               m_reducible[level].push_back(n);
+            return n;
+         }
+
+         /// merges the children of the most recently created node on the deepest level into that node
+         void Reduce()
+         {
+            int level = MaxDepth - 1;
+            while (level > 0 && m_reducible[level].empty())
+               --level;
+
+            int32_t n = m_reducible[level].back();
+            m_reducible[level].pop_back();
+
+            Node & node = m_nodes[n];
+            int merged = 0;
+            for (int32_t & child : node.children)
+            {
+               if (child < 0)
+                  continue;
+
+               Node const & leaf = m_nodes[child];
+               for (int i = 0; i < 4; ++i)
+                  node.sum[i] += leaf.sum[i];
+               node.count += leaf.count;
+               m_free.push_back(child);
+               child = -1;
+               ++merged;
+            }
+            node.leaf = true;
+            m_leafCount -= merged - 1;
+         }
+
+         void AssignPalette(int32_t n, std::vector<uint32_t> & palette)
+         {
+            Node & node = m_nodes[n];
+            if (!node.leaf)
+            {
+               for (int32_t child : node.children)
+                  if (child >= 0)
+                     AssignPalette(child, palette);
+               return;
+            }
+
+            if (!node.count)  // only the root of an empty tree
+               return;
+
+            uint64_t half = node.count / 2;
+            uint32_t r = uint32_t((node.sum[0] + half) / node.count);
+            uint32_t g = uint32_t((node.sum[1] + half) / node.count);
+            uint32_t b = uint32_t((node.sum[2] + half) / node.count);
+            uint32_t a = uint32_t((node.sum[3] + half) / node.count);
+            node.paletteIndex = int(palette.size());
+            palette.push_back((a << 24) | (r << 16) | (g << 8) | b);
+         }
+
+         std::vector<Node> m_nodes;
+         std::vector<int32_t> m_free;
+         std::vector<int32_t> m_reducible[MaxDepth];
+         int32_t m_root = -1;
+         int m_leafCount = 0;
+         int m_maxColors;
+      };
+
+
+      /// nearest palette entry (RGB distance), cached per 5:5:5 cell
+      class CNearestColor
+      {
+      public:
+         CNearestColor(std::vector<uint32_t> const & palette, int skipIndex) :
+            m_palette(palette), m_skipIndex(skipIndex), m_cache(1 << 15, int16_t(-1)) {}
+
+         int Find(int r, int g, int b)
+         {
+            int cell = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+            int16_t & cached = m_cache[cell];
+            if (cached < 0)
+               cached = int16_t(Search((r & ~7) | 4, (g & ~7) | 4, (b & ~7) | 4));
+            return cached;
+         }
+
+      private:
+         int Search(int r, int g, int b) const
+         {
+            int best = 0;
+            int bestDist = INT32_MAX;
+            for (int i = 0; i < int(m_palette.size()); ++i)
+            {
+               if (i == m_skipIndex)
+                  continue;
+               uint32_t c = m_palette[i];
+               int dr = ChR(c) - r, dg = ChG(c) - g, db = ChB(c) - b;
+               int dist = dr * dr + dg * dg + db * db;
+               if (dist < bestDist)
+               {
+                  bestDist = dist;
+                  best = i;
+               }
+            }
+            return best;
+         }
+
+         std::vector<uint32_t> const & m_palette;
+         int m_skipIndex;
+         std::vector<int16_t> m_cache;
+      };
+
+   } // namespace
+
+
+   /** Maps \c src to palette indices, if it uses at most 256 distinct colors.
+
+       This is the fast path: a single pass over the pixels, using a small hash table
+       and skipping the lookup for runs of equal colors.
+       If \c src has an alpha channel (at least one pixel with alpha != 0), all pixels with alpha = 0
+       map to a single palette entry with the value 0. Otherwise, the full 32 bit values are kept.
+
+       \param dst [out] receives \c count palette indices. Undefined if the function fails.
+       \param palette [out] receives the palette (at least one entry).
+       \param transparentIndex [out, optional] receives the index of the transparent entry, or -1.
+       \param lossless [out, optional] receives false if transparent pixels had RGB values other than 0
+          that were dropped by keying, true if the indices expand back to \c src exactly.
+       \returns false if \c src has more than 256 distinct colors.
+   */
+   bool QuantizeExact(uint32_t const * src, size_t count, uint8_t * dst, std::vector<uint32_t> & palette, int * transparentIndex, bool * lossless)
+   {
+      palette.clear();
+      if (transparentIndex)
+         *transparentIndex = -1;
+
+      bool const keyed = HasAlphaChannel(src, count);
+      bool dropped = false;
+
+      CColorIndexMap map;
+      uint32_t lastColor = 0;
+      int lastIndex = -1;
+
+      for (size_t i = 0; i < count; ++i)
+      {
+         uint32_t c = src[i];
+         if (keyed && !(c >> 24))
+         {
+            dropped |= (c != 0);
+            c = 0;
+         }
+
+         if (c != lastColor || lastIndex < 0)
+         {
+            unsigned slot = 0;
+            int index = map.Find(c, slot);
+            if (index < 0)
+            {
+               if (palette.size() == 256)
+                  return false;
+               index = int(palette.size());
+               palette.push_back(c);
+               map.Insert(slot, c, index);
+               if (keyed && !c && transparentIndex)
+                  *transparentIndex = index;
+            }
+            lastColor = c;
+            lastIndex = index;
+         }
+         dst[i] = uint8_t(lastIndex);
+      }
+
+      if (palette.empty())
+         palette.push_back(0);
+      if (lossless)
+         *lossless = !dropped;
+      return true;
+   }
+
+
+   /** Maps \c src to a palette of up to 256 colors, using an octree quantizer.
+
+       If \c src has an alpha channel (at least one pixel with alpha != 0), pixels with alpha = 0
+       get palette entry 0 (with the value 0), leaving 255 entries for the other colors.
+
+       \param src, width, height: the source pixels, \c height rows of \c width pixels each (without padding).
+       \param dst [out] receives width * height palette indices.
+       \param palette [out] receives the palette (at least one entry).
+       \param dither: apply Floyd-Steinberg error diffusion (RGB only; alpha is taken from the palette).
+       \param transparentIndex [out, optional] receives the index of the transparent entry, or -1.
+   */
+   void QuantizeOctree(uint32_t const * src, uint32_t width, uint32_t height, uint8_t * dst, std::vector<uint32_t> & palette, bool dither, int * transparentIndex)
+   {
+      size_t const count = size_t(width) * height;
+      palette.clear();
+
+      bool hasTransparent = false;
+      if (HasAlphaChannel(src, count))
+         for (size_t i = 0; i < count && !hasTransparent; ++i)
+            hasTransparent = !(src[i] >> 24);
+
+      int const keyIndex = hasTransparent ? 0 : -1;
+      if (hasTransparent)
+         palette.push_back(0);
+      if (transparentIndex)
+         *transparentIndex = keyIndex;
+
+      // build the tree, adding runs of equal colors at once
+      COctree tree(hasTransparent ? 255 : 256);
+      for (size_t i = 0; i < count; )
+      {
+         uint32_t c = src[i];
+         size_t run = 1;
+         while (i + run < count && src[i + run] == c)
+            ++run;
+         if (!hasTransparent || (c >> 24))
+            tree.Add(c, uint32_t(run));
+         i += run;
+      }
+      tree.BuildPalette(palette);
+
+      if (palette.empty())
+         palette.push_back(0);
+
+      if (!dither)
+      {
+         uint32_t lastColor = 0;
+         int lastIndex = keyIndex;
+         for (size_t i = 0; i < count; ++i)
+         {
+            uint32_t c = src[i];
+            if (hasTransparent && !(c >> 24))
+            {
+               dst[i] = uint8_t(keyIndex);
+               continue;
+            }
+            if (c != lastColor || lastIndex < 0)
+            {
+               lastColor = c;
+               lastIndex = tree.Lookup(c);
+            }
+            dst[i] = uint8_t(lastIndex);
+         }
+         return;
+      }
+
+      // Floyd-Steinberg, error rows in 1/16 units, one pixel of padding on each side
+      CNearestColor nearest(palette, keyIndex);
+      std::vector<int> errCur(3 * (width + 2)), errNext(3 * (width + 2));
+      for (uint32_t y = 0; y < height; ++y)
+      {
+         uint32_t const * srcRow = src + size_t(y) * width;
+         uint8_t * dstRow = dst + size_t(y) * width;
+         std::fill(errNext.begin(), errNext.end(), 0);
+
+         for (uint32_t x = 0; x < width; ++x)
+         {
+            uint32_t c = srcRow[x];
+            if (hasTransparent && !(c >> 24))
+            {
+               dstRow[x] = uint8_t(keyIndex);
+               continue;
+            }
+
+            int * e = &errCur[3 * (x + 1)];
+            int r = Clamp255(ChR(c) + e[0] / 16);
+            int g = Clamp255(ChG(c) + e[1] / 16);
+            int b = Clamp255(ChB(c) + e[2] / 16);
+
+            int index = nearest.Find(r, g, b);
+            dstRow[x] = uint8_t(index);
+
+            uint32_t p = palette[index];
+            int const err[3] = { r - ChR(p), g - ChG(p), b - ChB(p) };
+            for (int ch = 0; ch < 3; ++ch)
+            {
+               e[3 + ch] += err[ch] * 7;
+               errNext[3 * x + ch] += err[ch] * 3;
+               errNext[3 * (x + 1) + ch] += err[ch] * 5;
+               errNext[3 * (x + 2) + ch] += err[ch];
+            }
+         }
+         errCur.swap(errNext);
+      }
+   }
+
+
+   /** Converts a 32 bit/pixel image to an \ref IndexedImage.
+       Uses \ref QuantizeExact if possible, \ref QuantizeOctree otherwise.
+
+       \param height: negative for top-down, positive for bottom-up buffers (only stored in \c result)
+       \param dither: see \ref QuantizeOctree, ignored if the exact palette can be used.
+       \returns true if the conversion is lossless, i.e. \ref ExpandIndexed restores \c src exactly.
+          false if colors were approximated, or transparent pixels had RGB values other than 0.
+   */
+   bool QuantizeImage(uint32_t const * src, int32_t width, int32_t height, IndexedImage & result, bool dither)
+   {
+      result.width = width;
+      result.height = height;
+      result.indices.resize(result.PixelCount());
+
+      uint32_t const absHeight = uint32_t(height < 0 ? -height : height);
+      bool lossless = false;
+      if (QuantizeExact(src, result.indices.size(), result.indices.data(), result.palette, &result.transparentIndex, &lossless))
+         return lossless;
+
+      QuantizeOctree(src, uint32_t(width), absHeight, result.indices.data(), result.palette, dither, &result.transparentIndex);
+      return false;
+   }
+
+
+   /** Expands palette indices to 32 bit/pixel quads.
+       Indices beyond \c paletteSize expand to 0.
+   */
+   void ExpandIndexed(uint8_t const * src, size_t count, uint32_t const * palette, size_t paletteSize, uint32_t * dst)
+   {
+      uint32_t lut[256] = {};
+      memcpy(lut, palette, std::min<size_t>(paletteSize, 256) * sizeof(uint32_t));
+
+      size_t i = 0;
+      for (; i + 4 <= count; i += 4)
+      {
+         dst[i + 0] = lut[src[i + 0]];
+         dst[i + 1] = lut[src[i + 1]];
+         dst[i + 2] = lut[src[i + 2]];
+         dst[i + 3] = lut[src[i + 3]];
+      }
+      for (; i < count; ++i)
+         dst[i] = lut[src[i]];
+   }
+
+   /** Expands \c image to \c dst, which must hold image.PixelCount() pixels */
+   void ExpandIndexed(IndexedImage const & image, uint32_t * dst)
+   {
+      ExpandIndexed(image.indices.data(), image.indices.size(), image.palette.data(), image.palette.size(), dst);
+   }
+
+} // namespace GDIUtil
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/** color quantization: converting 32 bit/pixel RGBA buffers to 8 bit/pixel + color palette, and back.
+
+    Pixels are uint32_t quads in GDI layout (0xAARRGGBB, see \ref CreateRGBADIBSection).
+    This header and quantize.cpp do not depend on Windows headers, so the kernels can be
+    built and benchmarked on other platforms, too.
+*/
+namespace GDIUtil
+{
+
+   /** an 8 bit/pixel image with a palette of up to 256 RGBA quads
+
+       \c height follows the \c BITMAPINFOHEADER convention: negative for top-down, positive for bottom-up.
+       Rows are stored in the same order as in the source buffer, without padding.
+   */
+   struct IndexedImage
+   {
+      int32_t width = 0;
+      int32_t height = 0;
+      std::vector<uint8_t> indices;    ///< one palette index per pixel
+      std::vector<uint32_t> palette;   ///< 1..256 entries
+      int transparentIndex = -1;       ///< palette entry used for transparent pixels (alpha = 0), -1 if there are none or the image has no alpha channel
+
+      size_t PixelCount() const { return size_t(width) * size_t(height < 0 ? -height : height); }
+   };
+
+   bool QuantizeExact(uint32_t const * src, size_t count, uint8_t * dst, std::vector<uint32_t> & palette, int * transparentIndex = nullptr, bool * lossless = nullptr);
+   void QuantizeOctree(uint32_t const * src, uint32_t width, uint32_t height, uint8_t * dst, std::vector<uint32_t> & palette, bool dither = false, int * transparentIndex = nullptr);
+   bool QuantizeImage(uint32_t const * src, int32_t width, int32_t height, IndexedImage & result, bool dither = false);
+
+   void ExpandIndexed(uint8_t const * src, size_t count, uint32_t const * palette, size_t paletteSize, uint32_t * dst);
+   void ExpandIndexed(IndexedImage const & image, uint32_t * dst);
+
+} // namespace GDIUtil